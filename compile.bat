@@ -1 +1,2 @@
 g++ -O3 -march=native -flto -std=c++17 -static main.cpp icon.o -o screenshot.exe -lgdi32
+g++ -O3 -march=native -flto -std=c++17 -static tuner.cpp -o tuner.exe
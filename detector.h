@@ -0,0 +1,377 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Shared by screenshot.exe and tuner.exe. Everything in here is reentrant:
+// thresholds come in through DetectorConfig, never from globals.
+
+typedef unsigned char BYTE;
+
+// ============================================================================
+// STRUCTURES
+// ============================================================================
+
+struct PixelPos {
+    int x, y;
+};
+
+// Detection settings; these initialisers are the defaults for both
+// screenshot.exe and tuner.exe
+struct DetectorConfig {
+    // Ring detection settings
+    double ringOuterRadius = 89.0;
+    double ringInnerRadius = 85.0;
+    int ringCenterOffsetX = -1;
+    int ringCenterOffsetY = 0;
+
+    // Safety check rectangles
+    int safetyRect1X = 63;
+    int safetyRect1Y = 79;
+    int safetyRect1Width = 60;
+    int safetyRect1Height = 6;
+    int safetyRect2X = 63;
+    int safetyRect2Y = 103;
+    int safetyRect2Width = 60;
+    int safetyRect2Height = 4;
+
+    // Detection thresholds
+    int minWhitePixels = 30;
+    int minRedPixels = 2;
+    int timerDurationMs = 1200;
+    int resetDelayMs = 200;
+
+    // Color thresholds (0-255)
+    int whiteThreshold = 0xFE;
+    int redThreshold = 50;
+    int otherChannelMax = 150;
+    int redDominance = 20;
+};
+
+// Colour class bits, one per rule; a pixel can match several
+enum ColorClass : BYTE {
+    COLOR_BLACK = 1 << 0,
+    COLOR_WHITE = 1 << 1,
+    COLOR_RED   = 1 << 2
+};
+
+// Classifies a BGR pixel with one branch-free lookup: class = r[R] & g[G] & b[B].
+// Each rule is a bit that stays set in every table whose channel it does
+// not constrain, so a new per-channel rule only needs a bit and its table
+// entries in Build(); the scan loops just test the bits they care about.
+// The one cross-channel rule (red dominance) is masked in arithmetically.
+struct ColorClassifier {
+    BYTE r[256], g[256], b[256];
+
+    // Thresholds the tables were built from
+    bool built = false;
+    int whiteThreshold, redThreshold, otherChannelMax, redDominance;
+
+    // Rebuilds the tables only when the colour thresholds changed
+    void Update(const DetectorConfig& cfg) {
+        if (built &&
+            whiteThreshold == cfg.whiteThreshold && redThreshold == cfg.redThreshold &&
+            otherChannelMax == cfg.otherChannelMax && redDominance == cfg.redDominance) {
+            return;
+        }
+        Build(cfg);
+    }
+
+    void Build(const DetectorConfig& cfg) {
+        whiteThreshold = cfg.whiteThreshold;
+        redThreshold = cfg.redThreshold;
+        otherChannelMax = cfg.otherChannelMax;
+        redDominance = cfg.redDominance;
+
+        for (int v = 0; v < 256; v++) {
+            BYTE black = (v == 0) ? COLOR_BLACK : 0;
+            BYTE white = (v >= cfg.whiteThreshold) ? COLOR_WHITE : 0;
+            r[v] = black | white | ((v >= cfg.redThreshold) ? COLOR_RED : 0);
+            g[v] = black | white | ((v < cfg.otherChannelMax) ? COLOR_RED : 0);
+            b[v] = black | white | ((v < cfg.otherChannelMax) ? COLOR_RED : 0);
+        }
+        built = true;
+    }
+
+    BYTE Classify(BYTE red, BYTE green, BYTE blue) const {
+        int margin = red - (green > blue ? green : blue) - redDominance;
+        BYTE notDominant = (BYTE)(-(margin < 0) & COLOR_RED);
+        return r[red] & g[green] & b[blue] & ~notDominant;
+    }
+};
+
+// Per-session detector state, one instance per frame stream
+struct DetectorState {
+    ColorClassifier classifier;
+    bool firstCondition = false;
+    double timerStartMs = 0.0;
+    std::vector<PixelPos> whitePixels;
+    std::vector<PixelPos> redPixels;
+};
+
+enum class DetectorResult {
+    Idle,           // No white segment found (or safety check failed while idle)
+    Armed,          // White segment found, waiting for the red needle
+    Waiting,        // Armed, needle not on the segment yet
+    TimedOut,       // Armed for longer than timerDurationMs, state reset
+    SafetyFailed,   // Safety rectangles lost while armed, state reset
+    Triggered       // Enough red pixels on the white segment
+};
+
+// ============================================================================
+// SHARED HELPERS
+// ============================================================================
+
+inline std::string trim(const std::string& str) {
+    size_t first = str.find_first_not_of(" \t\n\r\"");
+    if (first == std::string::npos) return "";
+    size_t last = str.find_last_not_of(" \t\n\r\",");
+    return str.substr(first, (last - first + 1));
+}
+
+// The one config.json key -> DetectorConfig mapping, shared by both loaders.
+// Returns false for keys that are not detection settings.
+inline bool ApplyDetectorKey(DetectorConfig& cfg, const std::string& key, const std::string& value) {
+    if (key == "ring_outer_radius") cfg.ringOuterRadius = std::stod(value);
+    else if (key == "ring_inner_radius") cfg.ringInnerRadius = std::stod(value);
+    else if (key == "ring_center_offset_x") cfg.ringCenterOffsetX = std::stoi(value);
+    else if (key == "ring_center_offset_y") cfg.ringCenterOffsetY = std::stoi(value);
+    else if (key == "safety_rect1_x") cfg.safetyRect1X = std::stoi(value);
+    else if (key == "safety_rect1_y") cfg.safetyRect1Y = std::stoi(value);
+    else if (key == "safety_rect1_width") cfg.safetyRect1Width = std::stoi(value);
+    else if (key == "safety_rect1_height") cfg.safetyRect1Height = std::stoi(value);
+    else if (key == "safety_rect2_x") cfg.safetyRect2X = std::stoi(value);
+    else if (key == "safety_rect2_y") cfg.safetyRect2Y = std::stoi(value);
+    else if (key == "safety_rect2_width") cfg.safetyRect2Width = std::stoi(value);
+    else if (key == "safety_rect2_height") cfg.safetyRect2Height = std::stoi(value);
+    else if (key == "min_white_pixels") cfg.minWhitePixels = std::stoi(value);
+    else if (key == "min_red_pixels") cfg.minRedPixels = std::stoi(value);
+    else if (key == "timer_duration_ms") cfg.timerDurationMs = std::stoi(value);
+    else if (key == "reset_delay_ms") cfg.resetDelayMs = std::stoi(value);
+    else if (key == "white_threshold") cfg.whiteThreshold = std::stoi(value);
+    else if (key == "red_threshold") cfg.redThreshold = std::stoi(value);
+    else if (key == "other_channel_max") cfg.otherChannelMax = std::stoi(value);
+    else if (key == "red_dominance") cfg.redDominance = std::stoi(value);
+    else return false;
+    return true;
+}
+
+inline std::vector<std::vector<PixelPos>> FindConnectedGroups(
+    const std::vector<PixelPos>& pixels, int width, int height, int minSize) {
+
+    std::vector<std::vector<PixelPos>> groups;
+    std::vector<bool> visited(pixels.size(), false);
+
+    // Index of the pixel at each position, -1 where there is none
+    std::vector<int> indexMap((size_t)width * height, -1);
+    for (size_t i = 0; i < pixels.size(); i++) {
+        const PixelPos& p = pixels[i];
+        if (p.x >= 0 && p.x < width && p.y >= 0 && p.y < height) {
+            indexMap[(size_t)p.y * width + p.x] = (int)i;
+        }
+    }
+
+    for (size_t i = 0; i < pixels.size(); i++) {
+        if (visited[i]) continue;
+
+        std::vector<PixelPos> group;
+        std::vector<size_t> toVisit;
+        toVisit.push_back(i);
+
+        while (!toVisit.empty()) {
+            size_t idx = toVisit.back();
+            toVisit.pop_back();
+
+            if (visited[idx]) continue;
+            visited[idx] = true;
+
+            PixelPos current = pixels[idx];
+            group.push_back(current);
+
+            int dx[] = {0, 0, -1, 1};
+            int dy[] = {-1, 1, 0, 0};
+
+            for (int d = 0; d < 4; d++) {
+                int nx = current.x + dx[d];
+                int ny = current.y + dy[d];
+
+                if (nx >= 0 && nx < width && ny >= 0 && ny < height) {
+                    int j = indexMap[(size_t)ny * width + nx];
+                    if (j >= 0 && !visited[j]) {
+                        toVisit.push_back(j);
+                    }
+                }
+            }
+        }
+
+        if (group.size() >= (size_t)minSize) {
+            groups.push_back(group);
+        }
+    }
+
+    return groups;
+}
+
+// ============================================================================
+// PIXEL CHECKING FUNCTIONS
+// ============================================================================
+
+inline bool IsInRing(int x, int y, int centerX, int centerY, double innerRadius, double outerRadius) {
+    double dx = x - centerX;
+    double dy = y - centerY;
+    double distSq = dx * dx + dy * dy;
+    double innerSq = innerRadius * innerRadius;
+    double outerSq = outerRadius * outerRadius;
+    return distSq > innerSq && distSq < outerSq;
+}
+
+inline bool IsRectangleBlack(const BYTE* buf, int bufWidth, int x, int y, int width, int height,
+                             const ColorClassifier& classifier) {
+    int rowSize = ((bufWidth * 3 + 3) / 4) * 4;
+
+    for (int py = y; py < y + height; py++) {
+        for (int px = x; px < x + width; px++) {
+            if (px >= 0 && px < bufWidth && py >= 0) {
+                int index = py * rowSize + px * 3;
+                BYTE b = buf[index + 0];
+                BYTE g = buf[index + 1];
+                BYTE r = buf[index + 2];
+
+                if (!(classifier.Classify(r, g, b) & COLOR_BLACK)) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+inline bool AreSafetyRectsBlack(const BYTE* buf, int size, const DetectorConfig& cfg,
+                                const ColorClassifier& classifier) {
+    return IsRectangleBlack(buf, size, cfg.safetyRect1X, cfg.safetyRect1Y,
+                            cfg.safetyRect1Width, cfg.safetyRect1Height, classifier) &&
+           IsRectangleBlack(buf, size, cfg.safetyRect2X, cfg.safetyRect2Y,
+                            cfg.safetyRect2Width, cfg.safetyRect2Height, classifier);
+}
+
+// ============================================================================
+// DETECTION PIPELINE
+// ============================================================================
+
+// Pixels inside the ring of a size x size capture, in scan order. Depends
+// only on the ring settings, so callers build it once and reuse it.
+inline std::vector<PixelPos> ComputeRingPixels(int size, const DetectorConfig& cfg) {
+    int centerX = size / 2 + cfg.ringCenterOffsetX;
+    int centerY = size / 2 + cfg.ringCenterOffsetY;
+
+    std::vector<PixelPos> ringPixels;
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            if (IsInRing(x, y, centerX, centerY, cfg.ringInnerRadius, cfg.ringOuterRadius)) {
+                PixelPos pos;
+                pos.x = x;
+                pos.y = y;
+                ringPixels.push_back(pos);
+            }
+        }
+    }
+    return ringPixels;
+}
+
+// Runs one frame (24-bit bottom-up DIB, size x size) through the detector.
+// ringPixels comes from ComputeRingPixels for the same size and config.
+// nowMs() returns a monotonic clock in milliseconds. It is read when the
+// timeout is checked and again after the ring scan when arming, so the
+// timer window does not include the scan itself. safetyRectsBlack() is
+// only called when the state machine needs it; the tuner answers it from
+// a per-frame result cached at load time. The caller owns sleeping after
+// TimedOut and pressing space after Triggered.
+template <typename Clock, typename SafetyCheck>
+DetectorResult ProcessFrame(const BYTE* buf, int size, const DetectorConfig& cfg,
+                            const std::vector<PixelPos>& ringPixels,
+                            DetectorState& state, Clock nowMs, SafetyCheck safetyRectsBlack) {
+    int rowSize = ((size * 3 + 3) / 4) * 4;
+
+    state.classifier.Update(cfg);
+    const ColorClassifier& classifier = state.classifier;
+
+    if (!state.firstCondition) {
+        state.whitePixels.clear();
+        state.redPixels.clear();
+
+        if (!safetyRectsBlack()) {
+            return DetectorResult::Idle;
+        }
+
+        std::vector<PixelPos> candidatePixels;
+
+        for (const auto& pos : ringPixels) {
+            const BYTE* pixel = buf + pos.y * rowSize + pos.x * 3;
+            if (classifier.Classify(pixel[2], pixel[1], pixel[0]) & COLOR_WHITE) {
+                candidatePixels.push_back(pos);
+            }
+        }
+
+        std::vector<std::vector<PixelPos>> groups =
+            FindConnectedGroups(candidatePixels, size, size, cfg.minWhitePixels);
+
+        for (const auto& group : groups) {
+            for (const auto& pixel : group) {
+                state.whitePixels.push_back(pixel);
+            }
+        }
+
+        if (state.whitePixels.empty()) {
+            return DetectorResult::Idle;
+        }
+
+        state.firstCondition = true;
+        state.timerStartMs = nowMs();
+        return DetectorResult::Armed;
+    }
+
+    if (nowMs() - state.timerStartMs >= cfg.timerDurationMs) {
+        state.firstCondition = false;
+        state.whitePixels.clear();
+        state.redPixels.clear();
+        return DetectorResult::TimedOut;
+    }
+
+    // DOUBLE-CHECK: Verify safety rectangles are still black
+    if (!safetyRectsBlack()) {
+        state.firstCondition = false;
+        state.whitePixels.clear();
+        state.redPixels.clear();
+        return DetectorResult::SafetyFailed;
+    }
+
+    state.redPixels.clear();
+    for (const auto& pos : state.whitePixels) {
+        int x = pos.x;
+        int y = pos.y;
+        if (x >= 0 && x < size && y >= 0 && y < size) {
+            BYTE b = buf[y * rowSize + x * 3 + 0];
+            BYTE g = buf[y * rowSize + x * 3 + 1];
+            BYTE r = buf[y * rowSize + x * 3 + 2];
+
+            if (classifier.Classify(r, g, b) & COLOR_RED) {
+                state.redPixels.push_back(pos);
+            }
+        }
+    }
+
+    if (state.redPixels.size() >= (size_t)cfg.minRedPixels) {
+        return DetectorResult::Triggered;
+    }
+    return DetectorResult::Waiting;
+}
+
+// Live path: checks the safety rectangles on the frame itself
+template <typename Clock>
+DetectorResult ProcessFrame(const BYTE* buf, int size, const DetectorConfig& cfg,
+                            const std::vector<PixelPos>& ringPixels,
+                            DetectorState& state, Clock nowMs) {
+    return ProcessFrame(buf, size, cfg, ringPixels, state, nowMs, [&]() {
+        return AreSafetyRectsBlack(buf, size, cfg, state.classifier);
+    });
+}
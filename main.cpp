@@ -5,14 +5,20 @@
 #include <cmath>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
 #include <random>
 #include <fstream>
 #include <sstream>
 #include <chrono>
 #include <algorithm>
 #include <cctype>
+#include <cstdio>
 #include <conio.h>
 
+#include "detector.h"
+
 // ============================================================================
 // DEFAULT CONFIGURATION - Used when creating new config.json
 // ============================================================================
@@ -23,33 +29,8 @@ int CAPTURE_POS_X = 1187;
 int CAPTURE_POS_Y = 607;
 int FPS = 90;
 
-// Ring detection settings
-double RING_OUTER_RADIUS = 89.0;
-double RING_INNER_RADIUS = 85.0;
-int RING_CENTER_OFFSET_X = -1;
-int RING_CENTER_OFFSET_Y = 0;
-
-// Safety check rectangles
-int SAFETY_RECT1_X = 63;
-int SAFETY_RECT1_Y = 79;
-int SAFETY_RECT1_WIDTH = 60;
-int SAFETY_RECT1_HEIGHT = 6;
-int SAFETY_RECT2_X = 63;
-int SAFETY_RECT2_Y = 103;
-int SAFETY_RECT2_WIDTH = 60;
-int SAFETY_RECT2_HEIGHT = 4;
-
-// Detection thresholds
-int MIN_WHITE_PIXELS = 30;
-int MIN_RED_PIXELS = 2;
-int TIMER_DURATION_MS = 1200;
-int RESET_DELAY_MS = 200;
-
-// Color thresholds (0-255)
-int WHITE_THRESHOLD = 0xFE;
-int RED_THRESHOLD = 50;
-int OTHER_CHANNEL_MAX = 150;
-int RED_DOMINANCE = 20;
+// Ring, safety rectangle, pixel count and colour settings (defaults in detector.h)
+DetectorConfig DETECTOR_CONFIG;
 
 // Key press settings
 int SPACE_PRESS_MIN_MS = 50;
@@ -58,11 +39,29 @@ int SPACE_PRESS_MAX_MS = 90;
 // Save settings
 bool SAVE_ENABLED = true;
 
+// Recording settings - raw frames + frames.txt for tuner.exe, empty = off
+std::string RECORD_DIR = "";
+
 // ============================================================================
 // GLOBALS
 // ============================================================================
 
 std::mutex saveMutex;
+// Recording hand-off: the capture loop queues frames, one writer thread
+// drains them. Frames are dropped (and counted) when the queue is full.
+struct RecordJob {
+    BYTE* bits;             // Owned by the job; NULL for a comment line
+    int size;
+    double timestampMs;
+    std::string line;
+};
+
+const size_t RECORD_QUEUE_MAX = 64;
+std::mutex recordMutex;
+std::condition_variable recordCv;
+std::deque<RecordJob> recordQueue;
+std::atomic<int> recordDropped(0);
+std::string recordSessionDir;
 
 // ============================================================================
 // JSON CONFIGURATION
@@ -80,42 +79,36 @@ void SaveConfigToJson(const char* filename) {
     file << "  \"capture_pos_x\": " << CAPTURE_POS_X << ",\n";
     file << "  \"capture_pos_y\": " << CAPTURE_POS_Y << ",\n";
     file << "  \"fps\": " << FPS << ",\n";
-    file << "  \"ring_outer_radius\": " << RING_OUTER_RADIUS << ",\n";
-    file << "  \"ring_inner_radius\": " << RING_INNER_RADIUS << ",\n";
-    file << "  \"ring_center_offset_x\": " << RING_CENTER_OFFSET_X << ",\n";
-    file << "  \"ring_center_offset_y\": " << RING_CENTER_OFFSET_Y << ",\n";
-    file << "  \"safety_rect1_x\": " << SAFETY_RECT1_X << ",\n";
-    file << "  \"safety_rect1_y\": " << SAFETY_RECT1_Y << ",\n";
-    file << "  \"safety_rect1_width\": " << SAFETY_RECT1_WIDTH << ",\n";
-    file << "  \"safety_rect1_height\": " << SAFETY_RECT1_HEIGHT << ",\n";
-    file << "  \"safety_rect2_x\": " << SAFETY_RECT2_X << ",\n";
-    file << "  \"safety_rect2_y\": " << SAFETY_RECT2_Y << ",\n";
-    file << "  \"safety_rect2_width\": " << SAFETY_RECT2_WIDTH << ",\n";
-    file << "  \"safety_rect2_height\": " << SAFETY_RECT2_HEIGHT << ",\n";
-    file << "  \"min_white_pixels\": " << MIN_WHITE_PIXELS << ",\n";
-    file << "  \"min_red_pixels\": " << MIN_RED_PIXELS << ",\n";
-    file << "  \"timer_duration_ms\": " << TIMER_DURATION_MS << ",\n";
-    file << "  \"reset_delay_ms\": " << RESET_DELAY_MS << ",\n";
-    file << "  \"white_threshold\": " << WHITE_THRESHOLD << ",\n";
-    file << "  \"red_threshold\": " << RED_THRESHOLD << ",\n";
-    file << "  \"other_channel_max\": " << OTHER_CHANNEL_MAX << ",\n";
-    file << "  \"red_dominance\": " << RED_DOMINANCE << ",\n";
+    file << "  \"ring_outer_radius\": " << DETECTOR_CONFIG.ringOuterRadius << ",\n";
+    file << "  \"ring_inner_radius\": " << DETECTOR_CONFIG.ringInnerRadius << ",\n";
+    file << "  \"ring_center_offset_x\": " << DETECTOR_CONFIG.ringCenterOffsetX << ",\n";
+    file << "  \"ring_center_offset_y\": " << DETECTOR_CONFIG.ringCenterOffsetY << ",\n";
+    file << "  \"safety_rect1_x\": " << DETECTOR_CONFIG.safetyRect1X << ",\n";
+    file << "  \"safety_rect1_y\": " << DETECTOR_CONFIG.safetyRect1Y << ",\n";
+    file << "  \"safety_rect1_width\": " << DETECTOR_CONFIG.safetyRect1Width << ",\n";
+    file << "  \"safety_rect1_height\": " << DETECTOR_CONFIG.safetyRect1Height << ",\n";
+    file << "  \"safety_rect2_x\": " << DETECTOR_CONFIG.safetyRect2X << ",\n";
+    file << "  \"safety_rect2_y\": " << DETECTOR_CONFIG.safetyRect2Y << ",\n";
+    file << "  \"safety_rect2_width\": " << DETECTOR_CONFIG.safetyRect2Width << ",\n";
+    file << "  \"safety_rect2_height\": " << DETECTOR_CONFIG.safetyRect2Height << ",\n";
+    file << "  \"min_white_pixels\": " << DETECTOR_CONFIG.minWhitePixels << ",\n";
+    file << "  \"min_red_pixels\": " << DETECTOR_CONFIG.minRedPixels << ",\n";
+    file << "  \"timer_duration_ms\": " << DETECTOR_CONFIG.timerDurationMs << ",\n";
+    file << "  \"reset_delay_ms\": " << DETECTOR_CONFIG.resetDelayMs << ",\n";
+    file << "  \"white_threshold\": " << DETECTOR_CONFIG.whiteThreshold << ",\n";
+    file << "  \"red_threshold\": " << DETECTOR_CONFIG.redThreshold << ",\n";
+    file << "  \"other_channel_max\": " << DETECTOR_CONFIG.otherChannelMax << ",\n";
+    file << "  \"red_dominance\": " << DETECTOR_CONFIG.redDominance << ",\n";
     file << "  \"space_press_min_ms\": " << SPACE_PRESS_MIN_MS << ",\n";
     file << "  \"space_press_max_ms\": " << SPACE_PRESS_MAX_MS << ",\n";
-    file << "  \"save_enabled\": " << (SAVE_ENABLED ? "true" : "false") << "\n";
+    file << "  \"save_enabled\": " << (SAVE_ENABLED ? "true" : "false") << ",\n";
+    file << "  \"record_dir\": \"" << RECORD_DIR << "\"\n";
     file << "}\n";
     
     file.close();
     std::cout << "Configuration saved to " << filename << "\n";
 }
 
-std::string trim(const std::string& str) {
-    size_t first = str.find_first_not_of(" \t\n\r\"");
-    if (first == std::string::npos) return "";
-    size_t last = str.find_last_not_of(" \t\n\r\",");
-    return str.substr(first, (last - first + 1));
-}
-
 bool LoadConfigFromJson(const char* filename) {
     std::ifstream file(filename);
     if (!file) {
@@ -130,47 +123,22 @@ bool LoadConfigFromJson(const char* filename) {
         std::string key = trim(line.substr(0, colon));
         std::string value = trim(line.substr(colon + 1));
         
+        if (ApplyDetectorKey(DETECTOR_CONFIG, key, value)) continue;
+        
         if (key == "capture_size") CAPTURE_SIZE = std::stoi(value);
         else if (key == "capture_pos_x") CAPTURE_POS_X = std::stoi(value);
         else if (key == "capture_pos_y") CAPTURE_POS_Y = std::stoi(value);
         else if (key == "fps") FPS = std::stoi(value);
-        else if (key == "ring_outer_radius") RING_OUTER_RADIUS = std::stod(value);
-        else if (key == "ring_inner_radius") RING_INNER_RADIUS = std::stod(value);
-        else if (key == "ring_center_offset_x") RING_CENTER_OFFSET_X = std::stoi(value);
-        else if (key == "ring_center_offset_y") RING_CENTER_OFFSET_Y = std::stoi(value);
-        else if (key == "safety_rect1_x") SAFETY_RECT1_X = std::stoi(value);
-        else if (key == "safety_rect1_y") SAFETY_RECT1_Y = std::stoi(value);
-        else if (key == "safety_rect1_width") SAFETY_RECT1_WIDTH = std::stoi(value);
-        else if (key == "safety_rect1_height") SAFETY_RECT1_HEIGHT = std::stoi(value);
-        else if (key == "safety_rect2_x") SAFETY_RECT2_X = std::stoi(value);
-        else if (key == "safety_rect2_y") SAFETY_RECT2_Y = std::stoi(value);
-        else if (key == "safety_rect2_width") SAFETY_RECT2_WIDTH = std::stoi(value);
-        else if (key == "safety_rect2_height") SAFETY_RECT2_HEIGHT = std::stoi(value);
-        else if (key == "min_white_pixels") MIN_WHITE_PIXELS = std::stoi(value);
-        else if (key == "min_red_pixels") MIN_RED_PIXELS = std::stoi(value);
-        else if (key == "timer_duration_ms") TIMER_DURATION_MS = std::stoi(value);
-        else if (key == "reset_delay_ms") RESET_DELAY_MS = std::stoi(value);
-        else if (key == "white_threshold") WHITE_THRESHOLD = std::stoi(value);
-        else if (key == "red_threshold") RED_THRESHOLD = std::stoi(value);
-        else if (key == "other_channel_max") OTHER_CHANNEL_MAX = std::stoi(value);
-        else if (key == "red_dominance") RED_DOMINANCE = std::stoi(value);
         else if (key == "space_press_min_ms") SPACE_PRESS_MIN_MS = std::stoi(value);
         else if (key == "space_press_max_ms") SPACE_PRESS_MAX_MS = std::stoi(value);
         else if (key == "save_enabled") SAVE_ENABLED = (value == "true");
+        else if (key == "record_dir") RECORD_DIR = value;
     }
     
     file.close();
     return true;
 }
 
-// ============================================================================
-// STRUCTURES
-// ============================================================================
-
-struct PixelPos {
-    int x, y;
-};
-
 // ============================================================================
 // UTILITY FUNCTIONS
 // ============================================================================
@@ -198,6 +166,33 @@ void PressSpaceKey() {
     SendInput(1, &input, sizeof(INPUT));
 }
 
+void WriteBitmapFile(const char* filename, const BYTE* bits, int width, int height) {
+    int rowSize = ((width * 3 + 3) / 4) * 4;
+    DWORD bmpSize = rowSize * height;
+
+    BITMAPINFOHEADER bi = {0};
+    bi.biSize = sizeof(BITMAPINFOHEADER);
+    bi.biWidth = width;
+    bi.biHeight = height;
+    bi.biPlanes = 1;
+    bi.biBitCount = 24;
+    bi.biCompression = BI_RGB;
+    
+    HANDLE hFile = CreateFileA(filename, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile != INVALID_HANDLE_VALUE) {
+        BITMAPFILEHEADER bfh = {0};
+        bfh.bfType = 0x4D42;
+        bfh.bfSize = sizeof(bfh) + sizeof(bi) + bmpSize;
+        bfh.bfOffBits = sizeof(bfh) + sizeof(bi);
+
+        DWORD written;
+        WriteFile(hFile, &bfh, sizeof(bfh), &written, NULL);
+        WriteFile(hFile, &bi, sizeof(bi), &written, NULL);
+        WriteFile(hFile, bits, bmpSize, &written, NULL);
+        CloseHandle(hFile);
+    }
+}
+
 void SaveBitmapWithHighlights(const char* filename, BYTE* originalBits, int width, int height,
                                const std::vector<PixelPos>& whitePixels,
                                const std::vector<PixelPos>& redPixels) {
@@ -210,16 +205,17 @@ void SaveBitmapWithHighlights(const char* filename, BYTE* originalBits, int widt
     memcpy(bits, originalBits, bmpSize);
     
     // Mark safety rectangles in BLUE
-    for (int y = SAFETY_RECT1_Y; y < SAFETY_RECT1_Y + SAFETY_RECT1_HEIGHT; y++) {
-        for (int x = SAFETY_RECT1_X; x < SAFETY_RECT1_X + SAFETY_RECT1_WIDTH; x++) {
+    const DetectorConfig& cfg = DETECTOR_CONFIG;
+    for (int y = cfg.safetyRect1Y; y < cfg.safetyRect1Y + cfg.safetyRect1Height; y++) {
+        for (int x = cfg.safetyRect1X; x < cfg.safetyRect1X + cfg.safetyRect1Width; x++) {
             if (x >= 0 && x < width && y >= 0 && y < height) {
                 int index = y * rowSize + x * 3;
                 bits[index + 0] = 0xFF; bits[index + 1] = 0x00; bits[index + 2] = 0x00;
             }
         }
     }
-    for (int y = SAFETY_RECT2_Y; y < SAFETY_RECT2_Y + SAFETY_RECT2_HEIGHT; y++) {
-        for (int x = SAFETY_RECT2_X; x < SAFETY_RECT2_X + SAFETY_RECT2_WIDTH; x++) {
+    for (int y = cfg.safetyRect2Y; y < cfg.safetyRect2Y + cfg.safetyRect2Height; y++) {
+        for (int x = cfg.safetyRect2X; x < cfg.safetyRect2X + cfg.safetyRect2Width; x++) {
             if (x >= 0 && x < width && y >= 0 && y < height) {
                 int index = y * rowSize + x * 3;
                 bits[index + 0] = 0xFF; bits[index + 1] = 0x00; bits[index + 2] = 0x00;
@@ -243,145 +239,105 @@ void SaveBitmapWithHighlights(const char* filename, BYTE* originalBits, int widt
         }
     }
     
-    BITMAPINFOHEADER bi = {0};
-    bi.biSize = sizeof(BITMAPINFOHEADER);
-    bi.biWidth = width;
-    bi.biHeight = height;
-    bi.biPlanes = 1;
-    bi.biBitCount = 24;
-    bi.biCompression = BI_RGB;
-    
-    HANDLE hFile = CreateFileA(filename, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
-    if (hFile != INVALID_HANDLE_VALUE) {
-        BITMAPFILEHEADER bfh = {0};
-        bfh.bfType = 0x4D42;
-        bfh.bfSize = sizeof(bfh) + sizeof(bi) + bmpSize;
-        bfh.bfOffBits = sizeof(bfh) + sizeof(bi);
-
-        DWORD written;
-        WriteFile(hFile, &bfh, sizeof(bfh), &written, NULL);
-        WriteFile(hFile, &bi, sizeof(bi), &written, NULL);
-        WriteFile(hFile, bits, bmpSize, &written, NULL);
-        CloseHandle(hFile);
-    }
+    WriteBitmapFile(filename, bits, width, height);
     
     delete[] bits;
 }
 
-std::vector<std::vector<PixelPos>> FindConnectedGroups(
-    const std::vector<PixelPos>& pixels, int width, int height, int minSize) {
-    
-    std::vector<std::vector<PixelPos>> groups;
-    std::vector<bool> visited(pixels.size(), false);
-    
-    std::vector<std::vector<bool>> pixelMap(height, std::vector<bool>(width, false));
-    for (const auto& p : pixels) {
-        if (p.x >= 0 && p.x < width && p.y >= 0 && p.y < height) {
-            pixelMap[p.y][p.x] = true;
-        }
-    }
-    
-    for (size_t i = 0; i < pixels.size(); i++) {
-        if (visited[i]) continue;
-        
-        std::vector<PixelPos> group;
-        std::vector<size_t> toVisit;
-        toVisit.push_back(i);
-        
-        while (!toVisit.empty()) {
-            size_t idx = toVisit.back();
-            toVisit.pop_back();
-            
-            if (visited[idx]) continue;
-            visited[idx] = true;
-            
-            PixelPos current = pixels[idx];
-            group.push_back(current);
-            
-            int dx[] = {0, 0, -1, 1};
-            int dy[] = {-1, 1, 0, 0};
-            
-            for (int d = 0; d < 4; d++) {
-                int nx = current.x + dx[d];
-                int ny = current.y + dy[d];
-                
-                if (nx >= 0 && nx < width && ny >= 0 && ny < height && pixelMap[ny][nx]) {
-                    for (size_t j = 0; j < pixels.size(); j++) {
-                        if (!visited[j] && pixels[j].x == nx && pixels[j].y == ny) {
-                            toVisit.push_back(j);
-                            break;
-                        }
-                    }
-                }
-            }
-        }
-        
-        if (group.size() >= minSize) {
-            groups.push_back(group);
+// Creates a fresh RECORD_DIR/session_YYYYMMDD_HHMMSS[_N] so a new run never
+// reuses frame names or frames.txt from an earlier one
+bool CreateRecordSession() {
+    CreateDirectoryA(RECORD_DIR.c_str(), NULL);
+
+    SYSTEMTIME st;
+    GetLocalTime(&st);
+    char stamp[32];
+    snprintf(stamp, sizeof(stamp), "session_%04d%02d%02d_%02d%02d%02d",
+             st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+
+    for (int attempt = 1; attempt < 100; attempt++) {
+        std::string dir = RECORD_DIR + "/" + stamp;
+        if (attempt > 1) dir += "_" + std::to_string(attempt);
+
+        if (CreateDirectoryA(dir.c_str(), NULL)) {
+            recordSessionDir = dir;
+            return true;
         }
+        if (GetLastError() != ERROR_ALREADY_EXISTS) break;
     }
-    
-    return groups;
+    return false;
 }
 
-// ============================================================================
-// PIXEL CHECKING FUNCTIONS
-// ============================================================================
+// Long-lived writer: owns frames.txt and writes each raw, un-highlighted
+// capture next to it with its QPC timestamp
+void RecordWriterThread() {
+    std::ofstream framesFile(recordSessionDir + "/frames.txt", std::ios::app);
+    int frameIndex = 0;
 
-bool IsInRing(int x, int y, int centerX, int centerY, double innerRadius, double outerRadius) {
-    double dx = x - centerX;
-    double dy = y - centerY;
-    double distSq = dx * dx + dy * dy;
-    double innerSq = innerRadius * innerRadius;
-    double outerSq = outerRadius * outerRadius;
-    return distSq > innerSq && distSq < outerSq;
-}
+    while (true) {
+        RecordJob job;
+        {
+            std::unique_lock<std::mutex> lock(recordMutex);
+            recordCv.wait(lock, []() { return !recordQueue.empty(); });
+            job = recordQueue.front();
+            recordQueue.pop_front();
+        }
 
-bool IsWhiteish(BYTE r, BYTE g, BYTE b) {
-    return r >= WHITE_THRESHOLD && g >= WHITE_THRESHOLD && b >= WHITE_THRESHOLD;
-}
+        int dropped = recordDropped.exchange(0);
+        if (dropped > 0) {
+            framesFile << "# dropped " << dropped << " frames\n";
+        }
 
-bool IsBlack(BYTE r, BYTE g, BYTE b) {
-    return r == 0 && g == 0 && b == 0;
-}
+        if (job.bits) {
+            char name[32];
+            snprintf(name, sizeof(name), "frame_%06d.bmp", frameIndex++);
+            WriteBitmapFile((recordSessionDir + "/" + name).c_str(), job.bits, job.size, job.size);
+            delete[] job.bits;
 
-bool IsReddish(BYTE r, BYTE g, BYTE b) {
-    return r >= RED_THRESHOLD && 
-           g < OTHER_CHANNEL_MAX && 
-           b < OTHER_CHANNEL_MAX &&
-           r >= (g + RED_DOMINANCE) &&
-           r >= (b + RED_DOMINANCE);
+            framesFile << std::fixed;
+            framesFile.precision(3);
+            framesFile << job.timestampMs << " " << name << "\n";
+        } else {
+            framesFile << job.line << "\n";
+        }
+        framesFile.flush();
+    }
 }
 
-bool IsRectangleBlack(BYTE* buf, int bufWidth, int x, int y, int width, int height) {
-    int rowSize = ((bufWidth * 3 + 3) / 4) * 4;
-    
-    for (int py = y; py < y + height; py++) {
-        for (int px = x; px < x + width; px++) {
-            if (px >= 0 && px < bufWidth && py >= 0) {
-                int index = py * rowSize + px * 3;
-                BYTE b = buf[index + 0];
-                BYTE g = buf[index + 1];
-                BYTE r = buf[index + 2];
-                
-                if (!IsBlack(r, g, b)) {
-                    return false;
-                }
-            }
+// Takes ownership of bits (NULL for a comment line); never blocks the caller
+void QueueRecordJob(BYTE* bits, int size, double timestampMs, const std::string& line) {
+    {
+        std::lock_guard<std::mutex> lock(recordMutex);
+        if (recordQueue.size() < RECORD_QUEUE_MAX) {
+            recordQueue.push_back({bits, size, timestampMs, line});
+            bits = NULL;
         }
     }
-    return true;
+    if (bits) {
+        delete[] bits;
+        recordDropped++;
+        return;
+    }
+    recordCv.notify_one();
+}
+
+// Ends a frame's life: hands the buffer to the recorder or frees it
+void FinishFrame(BYTE* buf, int size, double captureMs) {
+    if (RECORD_DIR.empty()) {
+        delete[] buf;
+        return;
+    }
+    QueueRecordJob(buf, size, captureMs, "");
 }
 
 // ============================================================================
 // MAIN CAPTURE AND PROCESSING
 // ============================================================================
 
-bool CaptureAndProcess(int size, int posX, int posY, 
-                       std::vector<PixelPos>& whitePixels,
-                       std::vector<PixelPos>& redPixels,
-                       bool& firstCondition, bool& secondCondition,
-                       LARGE_INTEGER& timerStart, LARGE_INTEGER freq) {
+bool CaptureAndProcess(int size, int posX, int posY, const DetectorConfig& cfg,
+                       const std::vector<PixelPos>& ringPixels,
+                       DetectorState& state, bool& secondCondition,
+                       LARGE_INTEGER freq) {
     
     HDC hScreen = GetDC(NULL);
     HDC hMem = CreateCompatibleDC(hScreen);
@@ -410,143 +366,67 @@ bool CaptureAndProcess(int size, int posX, int posY,
     BYTE* buf = new BYTE[sizeBytes];
     GetDIBits(hMem, hBitmap, 0, size, buf, (BITMAPINFO*)&bi, DIB_RGB_COLORS);
 
-    int rowSize = ((size * 3 + 3) / 4) * 4;
-    int centerX = size / 2 + RING_CENTER_OFFSET_X;
-    int centerY = size / 2 + RING_CENTER_OFFSET_Y;
+    SelectObject(hMem, old);
+    DeleteObject(hBitmap);
+    DeleteDC(hMem);
+    ReleaseDC(NULL, hScreen);
 
-    if (!firstCondition) {
-        whitePixels.clear();
-        redPixels.clear();
-        
-        bool rect1Black = IsRectangleBlack(buf, size, SAFETY_RECT1_X, SAFETY_RECT1_Y, 
-                                           SAFETY_RECT1_WIDTH, SAFETY_RECT1_HEIGHT);
-        bool rect2Black = IsRectangleBlack(buf, size, SAFETY_RECT2_X, SAFETY_RECT2_Y, 
-                                           SAFETY_RECT2_WIDTH, SAFETY_RECT2_HEIGHT);
-        
-        if (!rect1Black || !rect2Black) {
-            delete[] buf;
-            SelectObject(hMem, old);
-            DeleteObject(hBitmap);
-            DeleteDC(hMem);
-            ReleaseDC(NULL, hScreen);
-            return false;
-        }
-        
-        std::vector<PixelPos> candidatePixels;
-        
-        for (int y = 0; y < size; y++) {
-            for (int x = 0; x < size; x++) {
-                if (IsInRing(x, y, centerX, centerY, RING_INNER_RADIUS, RING_OUTER_RADIUS)) {
-                    BYTE b = buf[y * rowSize + x * 3 + 0];
-                    BYTE g = buf[y * rowSize + x * 3 + 1];
-                    BYTE r = buf[y * rowSize + x * 3 + 2];
-                    
-                    if (IsWhiteish(r, g, b)) {
-                        PixelPos pos;
-                        pos.x = x;
-                        pos.y = y;
-                        candidatePixels.push_back(pos);
-                    }
-                }
-            }
-        }
-        
-        std::vector<std::vector<PixelPos>> groups = 
-            FindConnectedGroups(candidatePixels, size, size, MIN_WHITE_PIXELS);
-        
-        for (const auto& group : groups) {
-            for (const auto& pixel : group) {
-                whitePixels.push_back(pixel);
-            }
-        }
-        
-        if (!whitePixels.empty()) {
-            firstCondition = true;
-            QueryPerformanceCounter(&timerStart);
-        }
-    }
-    else {
+    LARGE_INTEGER captured;
+    QueryPerformanceCounter(&captured);
+    double captureMs = captured.QuadPart * 1000.0 / freq.QuadPart;
+
+    DetectorResult result = ProcessFrame(buf, size, cfg, ringPixels, state, [freq]() {
         LARGE_INTEGER now;
         QueryPerformanceCounter(&now);
-        double elapsed = (now.QuadPart - timerStart.QuadPart) * 1000.0 / freq.QuadPart;
-        
-        if (elapsed >= TIMER_DURATION_MS) {
-            firstCondition = false;
-            whitePixels.clear();
-            redPixels.clear();
-            delete[] buf;
-            SelectObject(hMem, old);
-            DeleteObject(hBitmap);
-            DeleteDC(hMem);
-            ReleaseDC(NULL, hScreen);
-            Sleep(RESET_DELAY_MS);
-            return false;
-        }
-        
-        // DOUBLE-CHECK: Verify safety rectangles are still black
-        bool rect1Black = IsRectangleBlack(buf, size, SAFETY_RECT1_X, SAFETY_RECT1_Y, 
-                                           SAFETY_RECT1_WIDTH, SAFETY_RECT1_HEIGHT);
-        bool rect2Black = IsRectangleBlack(buf, size, SAFETY_RECT2_X, SAFETY_RECT2_Y, 
-                                           SAFETY_RECT2_WIDTH, SAFETY_RECT2_HEIGHT);
+        return now.QuadPart * 1000.0 / freq.QuadPart;
+    });
+
+    if (result == DetectorResult::TimedOut) {
+        FinishFrame(buf, size, captureMs);
+        Sleep(cfg.resetDelayMs);
+        return false;
+    }
+
+    if (result == DetectorResult::SafetyFailed) {
+        // Safety rectangles no longer black, reset condition
+        std::cout << "Safety check failed in second condition - resetting\n";
+        FinishFrame(buf, size, captureMs);
+        return false;
+    }
+
+    if (result == DetectorResult::Triggered) {
+        secondCondition = true;
         
-        if (!rect1Black || !rect2Black) {
-            // Safety rectangles no longer black, reset condition
-            std::cout << "Safety check failed in second condition - resetting\n";
-            firstCondition = false;
-            whitePixels.clear();
-            redPixels.clear();
-            delete[] buf;
-            SelectObject(hMem, old);
-            DeleteObject(hBitmap);
-            DeleteDC(hMem);
-            ReleaseDC(NULL, hScreen);
-            return false;
-        }
+        std::thread spaceThread([]() {
+            PressSpaceKey();
+        });
+        spaceThread.detach();
         
-        redPixels.clear();
-        for (const auto& pos : whitePixels) {
-            int x = pos.x;
-            int y = pos.y;
-            if (x >= 0 && x < size && y >= 0 && y < size) {
-                BYTE b = buf[y * rowSize + x * 3 + 0];
-                BYTE g = buf[y * rowSize + x * 3 + 1];
-                BYTE r = buf[y * rowSize + x * 3 + 2];
-                
-                if (IsReddish(r, g, b)) {
-                    redPixels.push_back(pos);
-                }
-            }
+        // Hint for labelling clips; tuner.exe skips '#' lines
+        if (!RECORD_DIR.empty()) {
+            std::ostringstream line;
+            line << std::fixed;
+            line.precision(3);
+            line << "# trigger " << captureMs;
+            QueueRecordJob(NULL, size, captureMs, line.str());
         }
         
-        if (redPixels.size() >= MIN_RED_PIXELS) {
-            secondCondition = true;
+        if (SAVE_ENABLED) {
+            BYTE* bufCopy = new BYTE[sizeBytes];
+            memcpy(bufCopy, buf, sizeBytes);
             
-            std::thread spaceThread([]() {
-                PressSpaceKey();
-            });
-            spaceThread.detach();
+            std::vector<PixelPos> whiteCopy = state.whitePixels;
+            std::vector<PixelPos> redCopy = state.redPixels;
             
-            if (SAVE_ENABLED) {
-                BYTE* bufCopy = new BYTE[sizeBytes];
-                memcpy(bufCopy, buf, sizeBytes);
-                
-                std::vector<PixelPos> whiteCopy = whitePixels;
-                std::vector<PixelPos> redCopy = redPixels;
-                
-                std::thread saveThread([bufCopy, size, whiteCopy, redCopy]() {
-                    SaveBitmapWithHighlights("output.bmp", bufCopy, size, size, whiteCopy, redCopy);
-                    delete[] bufCopy;
-                });
-                saveThread.detach();
-            }
+            std::thread saveThread([bufCopy, size, whiteCopy, redCopy]() {
+                SaveBitmapWithHighlights("output.bmp", bufCopy, size, size, whiteCopy, redCopy);
+                delete[] bufCopy;
+            });
+            saveThread.detach();
         }
     }
 
-    delete[] buf;
-    SelectObject(hMem, old);
-    DeleteObject(hBitmap);
-    DeleteDC(hMem);
-    ReleaseDC(NULL, hScreen);
+    FinishFrame(buf, size, captureMs);
     
     return secondCondition;
 }
@@ -631,6 +511,14 @@ int main() {
         }
     }
 
+    if (!RECORD_DIR.empty() && !CreateRecordSession()) {
+        std::cerr << "Failed to create a recording session in " << RECORD_DIR << ", recording disabled\n";
+        RECORD_DIR = "";
+    }
+    if (!RECORD_DIR.empty()) {
+        std::thread(RecordWriterThread).detach();
+    }
+
     double frameDelay = 1000.0 / FPS;
 
     LARGE_INTEGER freq;
@@ -640,43 +528,40 @@ int main() {
     std::cout << "Capture: " << CAPTURE_SIZE << "x" << CAPTURE_SIZE
               << " at (" << CAPTURE_POS_X << "," << CAPTURE_POS_Y << ") @ " << FPS << " FPS\n";
     std::cout << "Safety rectangles (must be black):\n";
-    std::cout << "  R1: (" << SAFETY_RECT1_X << "," << SAFETY_RECT1_Y << ") " 
-              << SAFETY_RECT1_WIDTH << "x" << SAFETY_RECT1_HEIGHT << "\n";
-    std::cout << "  R2: (" << SAFETY_RECT2_X << "," << SAFETY_RECT2_Y << ") " 
-              << SAFETY_RECT2_WIDTH << "x" << SAFETY_RECT2_HEIGHT << "\n";
-    std::cout << "Ring: inner=" << RING_INNER_RADIUS << " outer=" << RING_OUTER_RADIUS 
-              << " offset=(" << RING_CENTER_OFFSET_X << "," << RING_CENTER_OFFSET_Y << ")\n";
-    std::cout << "Conditions: white>=" << MIN_WHITE_PIXELS << " (connected), red>=" << MIN_RED_PIXELS << "\n";
-    std::cout << "Thresholds: white>=" << WHITE_THRESHOLD << ", red>=" << RED_THRESHOLD 
-              << ", other<" << OTHER_CHANNEL_MAX << ", dominance=" << RED_DOMINANCE << "\n";
-    std::cout << "Timing: timer=" << TIMER_DURATION_MS << "ms, reset=" << RESET_DELAY_MS 
+    std::cout << "  R1: (" << DETECTOR_CONFIG.safetyRect1X << "," << DETECTOR_CONFIG.safetyRect1Y << ") " 
+              << DETECTOR_CONFIG.safetyRect1Width << "x" << DETECTOR_CONFIG.safetyRect1Height << "\n";
+    std::cout << "  R2: (" << DETECTOR_CONFIG.safetyRect2X << "," << DETECTOR_CONFIG.safetyRect2Y << ") " 
+              << DETECTOR_CONFIG.safetyRect2Width << "x" << DETECTOR_CONFIG.safetyRect2Height << "\n";
+    std::cout << "Ring: inner=" << DETECTOR_CONFIG.ringInnerRadius << " outer=" << DETECTOR_CONFIG.ringOuterRadius 
+              << " offset=(" << DETECTOR_CONFIG.ringCenterOffsetX << "," << DETECTOR_CONFIG.ringCenterOffsetY << ")\n";
+    std::cout << "Conditions: white>=" << DETECTOR_CONFIG.minWhitePixels << " (connected), red>=" << DETECTOR_CONFIG.minRedPixels << "\n";
+    std::cout << "Thresholds: white>=" << DETECTOR_CONFIG.whiteThreshold << ", red>=" << DETECTOR_CONFIG.redThreshold 
+              << ", other<" << DETECTOR_CONFIG.otherChannelMax << ", dominance=" << DETECTOR_CONFIG.redDominance << "\n";
+    std::cout << "Timing: timer=" << DETECTOR_CONFIG.timerDurationMs << "ms, reset=" << DETECTOR_CONFIG.resetDelayMs 
               << "ms, space=" << SPACE_PRESS_MIN_MS << "-" << SPACE_PRESS_MAX_MS << "ms\n";
     std::cout << "Save: " << (SAVE_ENABLED ? "yes" : "no") << "\n";
+    std::cout << "Record: " << (RECORD_DIR.empty() ? "no" : recordSessionDir) << "\n";
     std::cout << "============================\n\n";
 
-    std::vector<PixelPos> whitePixels;
-    std::vector<PixelPos> redPixels;
-    bool firstCondition = false;
+    std::vector<PixelPos> ringPixels = ComputeRingPixels(CAPTURE_SIZE, DETECTOR_CONFIG);
+    DetectorState state;
     bool secondCondition = false;
-    LARGE_INTEGER timerStart;
 
     while (true) {
         LARGE_INTEGER frameStart;
         QueryPerformanceCounter(&frameStart);
 
         CaptureAndProcess(CAPTURE_SIZE, CAPTURE_POS_X, CAPTURE_POS_Y, 
-                         whitePixels, redPixels,
-                         firstCondition, secondCondition,
-                         timerStart, freq);
+                         DETECTOR_CONFIG, ringPixels, state, secondCondition, freq);
 
         if (secondCondition) {
-            std::cout << "SECOND CONDITION TRUE (detected " << redPixels.size() << " red pixels)\n";
+            std::cout << "SECOND CONDITION TRUE (detected " << state.redPixels.size() << " red pixels)\n";
             
-            Sleep(RESET_DELAY_MS);
-            firstCondition = false;
+            Sleep(DETECTOR_CONFIG.resetDelayMs);
+            state.firstCondition = false;
             secondCondition = false;
-            whitePixels.clear();
-            redPixels.clear();
+            state.whitePixels.clear();
+            state.redPixels.clear();
         }
 
         while (true) {
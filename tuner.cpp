@@ -0,0 +1,582 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdlib>
+
+#include "detector.h"
+
+// ============================================================================
+// OFFLINE PARAMETER TUNER
+// ============================================================================
+//
+// Replays labelled recordings through the detector for every candidate
+// setting and ranks them by trigger accuracy and timing error.
+//
+// Recording: set "record_dir" in config.json and run screenshot.exe. Each
+// run records into its own <record_dir>/session_YYYYMMDD_HHMMSS directory,
+// so earlier sessions are never overwritten. Every capture is written there
+// as a raw 24-bit BMP, listed in frames.txt as
+//     <timestamp_ms> <frame.bmp>
+// with QPC timestamps, plus a "# trigger <ms>" line wherever it pressed space
+// and "# dropped <n> frames" where the disk could not keep up.
+// A session directory is what a manifest line points at.
+//
+// Manifest (one clip per line, '#' starts a comment):
+//     <clip_dir> <expected_trigger_ms> [<start_ms> <end_ms>]
+// expected_trigger_ms is when space should have been pressed, in the
+// recording's timestamps, or -1 for a clip where the detector must not fire.
+// The optional window cuts one skill check out of a longer recording, so a
+// single record_dir can back many clips. Clip directories are relative to
+// the manifest.
+//
+// Usage:
+//     tuner.exe <manifest> [--config config.json] [--out tuned_config.json]
+//               [--random N] [--seed S] [--threads N] [--tolerance MS]
+//               [--<param> min:max:step] ...
+
+// Ring and safety settings are never tuned, so everything that depends only
+// on them is computed once at load time instead of per candidate
+struct Frame {
+    double timestampMs;
+    int size;
+    std::vector<BYTE> pixels;
+    bool safetyRectsBlack;
+};
+
+struct Clip {
+    std::string name;
+    double expectedTriggerMs;
+    double startMs = -std::numeric_limits<double>::infinity();
+    double endMs = std::numeric_limits<double>::infinity();
+    std::vector<Frame> frames;
+    std::vector<PixelPos> ringPixels;
+};
+
+struct ParamRange {
+    const char* key;
+    int DetectorConfig::* field;
+    int minValue, maxValue, step;
+};
+
+struct Score {
+    int correct = 0;
+    int timedClips = 0;
+    double timingErrorSum = 0.0;
+
+    double MeanTimingError() const {
+        if (timedClips == 0) return std::numeric_limits<double>::infinity();
+        return timingErrorSum / timedClips;
+    }
+};
+
+// Default search space, centred on the shipped defaults
+std::vector<ParamRange> DefaultParamRanges() {
+    return {
+        {"white_threshold",   &DetectorConfig::whiteThreshold,  230, 255, 5},
+        {"red_threshold",     &DetectorConfig::redThreshold,     30,  90, 20},
+        {"other_channel_max", &DetectorConfig::otherChannelMax, 100, 180, 20},
+        {"red_dominance",     &DetectorConfig::redDominance,     10,  40, 10},
+        {"min_white_pixels",  &DetectorConfig::minWhitePixels,   10,  50, 10},
+        {"min_red_pixels",    &DetectorConfig::minRedPixels,      1,   5, 1},
+    };
+}
+
+// ============================================================================
+// LOADING
+// ============================================================================
+
+std::string DirectoryOf(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    if (slash == std::string::npos) return "";
+    return path.substr(0, slash + 1);
+}
+
+unsigned int ReadLE(const unsigned char* p, int bytes) {
+    unsigned int value = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+bool LoadFrameBitmap(const std::string& filename, Frame& frame) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open frame " << filename << "\n";
+        return false;
+    }
+
+    // BITMAPFILEHEADER (14 bytes) + BITMAPINFOHEADER (40 bytes)
+    unsigned char header[54];
+    if (!file.read((char*)header, sizeof(header)) || header[0] != 'B' || header[1] != 'M') {
+        std::cerr << "Not a bitmap: " << filename << "\n";
+        return false;
+    }
+
+    unsigned int offBits = ReadLE(header + 10, 4);
+    int width = (int)ReadLE(header + 18, 4);
+    int height = (int)ReadLE(header + 22, 4);
+    int bitCount = (int)ReadLE(header + 28, 2);
+    int compression = (int)ReadLE(header + 30, 4);
+
+    // Must match what CaptureAndProcess gets back from GetDIBits
+    if (bitCount != 24 || compression != 0 || width <= 0 || width != height) {
+        std::cerr << "Expected a square, bottom-up, uncompressed 24-bit bitmap: " << filename << "\n";
+        return false;
+    }
+
+    int rowSize = ((width * 3 + 3) / 4) * 4;
+    frame.size = width;
+    frame.pixels.resize((size_t)rowSize * height);
+
+    file.seekg(offBits);
+    if (!file.read((char*)frame.pixels.data(), frame.pixels.size())) {
+        std::cerr << "Truncated bitmap: " << filename << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool LoadClip(const std::string& clipDir, const DetectorConfig& base, Clip& clip) {
+    // Black is threshold-independent, so any classifier answers the safety check
+    ColorClassifier classifier;
+    classifier.Build(base);
+
+    std::string framesFile = clipDir + "/frames.txt";
+    std::ifstream file(framesFile);
+    if (!file) {
+        std::cerr << "Failed to open " << framesFile << "\n";
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        line = trim(line);
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream in(line);
+        Frame frame;
+        std::string name;
+        if (!(in >> frame.timestampMs >> name)) {
+            std::cerr << "Bad line in " << framesFile << ": " << line << "\n";
+            return false;
+        }
+        if (frame.timestampMs < clip.startMs || frame.timestampMs > clip.endMs) continue;
+        if (!LoadFrameBitmap(clipDir + "/" + name, frame)) {
+            return false;
+        }
+        if (!clip.frames.empty() && frame.size != clip.frames[0].size) {
+            std::cerr << "Frame size changes within " << framesFile << "\n";
+            return false;
+        }
+        frame.safetyRectsBlack = AreSafetyRectsBlack(frame.pixels.data(), frame.size, base, classifier);
+        clip.frames.push_back(std::move(frame));
+    }
+
+    std::sort(clip.frames.begin(), clip.frames.end(),
+              [](const Frame& a, const Frame& b) { return a.timestampMs < b.timestampMs; });
+    if (!clip.frames.empty()) {
+        clip.ringPixels = ComputeRingPixels(clip.frames[0].size, base);
+    }
+    return true;
+}
+
+bool LoadManifest(const std::string& filename, const DetectorConfig& base, std::vector<Clip>& clips) {
+    std::ifstream file(filename);
+    if (!file) {
+        std::cerr << "Failed to open manifest " << filename << "\n";
+        return false;
+    }
+
+    std::string baseDir = DirectoryOf(filename);
+    std::string line;
+    while (std::getline(file, line)) {
+        line = trim(line);
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream in(line);
+        Clip clip;
+        if (!(in >> clip.name >> clip.expectedTriggerMs)) {
+            std::cerr << "Bad line in manifest: " << line << "\n";
+            return false;
+        }
+        double startMs, endMs;
+        if (in >> startMs >> endMs) {
+            clip.startMs = startMs;
+            clip.endMs = endMs;
+        }
+        if (!LoadClip(baseDir + clip.name, base, clip)) {
+            return false;
+        }
+        clips.push_back(std::move(clip));
+    }
+    return true;
+}
+
+// Only the detection keys; everything else in config.json is passed through
+bool LoadDetectorConfig(const char* filename, DetectorConfig& cfg) {
+    std::ifstream file(filename);
+    if (!file) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+
+        std::string key = trim(line.substr(0, colon));
+        std::string value = trim(line.substr(colon + 1));
+
+        ApplyDetectorKey(cfg, key, value);
+    }
+
+    file.close();
+    return true;
+}
+
+// Copies the base config line by line, replacing the tuned keys and
+// appending any tuned key the base file does not have yet
+bool SaveTunedConfig(const char* baseFilename, const char* filename,
+                     const DetectorConfig& cfg, const std::vector<ParamRange>& ranges) {
+    std::ifstream base(baseFilename);
+    if (!base) {
+        std::cerr << "Failed to open base config " << baseFilename << "\n";
+        return false;
+    }
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(base, line)) {
+        lines.push_back(line);
+    }
+    base.close();
+
+    std::vector<bool> written(ranges.size(), false);
+    size_t closingBrace = std::string::npos;
+    size_t lastEntry = std::string::npos;
+
+    for (size_t i = 0; i < lines.size(); i++) {
+        std::string& l = lines[i];
+        size_t colon = l.find(':');
+        if (colon == std::string::npos) {
+            if (l.find('}') != std::string::npos) closingBrace = i;
+            continue;
+        }
+        lastEntry = i;
+
+        std::string key = trim(l.substr(0, colon));
+        for (size_t r = 0; r < ranges.size(); r++) {
+            if (key != ranges[r].key) continue;
+            size_t end = l.find_last_not_of(" \t\r");
+            bool hasComma = end != std::string::npos && l[end] == ',';
+            std::ostringstream out;
+            out << "  \"" << ranges[r].key << "\": " << cfg.*(ranges[r].field) << (hasComma ? "," : "");
+            l = out.str();
+            written[r] = true;
+        }
+    }
+
+    std::vector<std::string> missing;
+    for (size_t r = 0; r < ranges.size(); r++) {
+        if (written[r]) continue;
+        std::ostringstream out;
+        out << "  \"" << ranges[r].key << "\": " << cfg.*(ranges[r].field);
+        missing.push_back(out.str());
+    }
+
+    if (!missing.empty()) {
+        if (closingBrace == std::string::npos) {
+            std::cerr << "No closing brace in " << baseFilename << ", cannot add missing keys\n";
+            return false;
+        }
+        if (lastEntry != std::string::npos && lastEntry < closingBrace) {
+            std::string& l = lines[lastEntry];
+            size_t end = l.find_last_not_of(" \t\r");
+            if (end != std::string::npos && l[end] != ',') l.insert(end + 1, ",");
+        }
+        for (size_t m = 0; m + 1 < missing.size(); m++) {
+            missing[m] += ",";
+        }
+        lines.insert(lines.begin() + closingBrace, missing.begin(), missing.end());
+    }
+
+    std::ofstream file(filename);
+    if (!file) {
+        std::cerr << "Failed to create " << filename << "\n";
+        return false;
+    }
+    for (const auto& l : lines) {
+        file << l << "\n";
+    }
+
+    file.close();
+    std::cout << "Configuration saved to " << filename << "\n";
+    return true;
+}
+
+// ============================================================================
+// EVALUATION
+// ============================================================================
+
+// Replays every clip the way the main loop would, including the reset delay
+// after a timeout, and scores the first trigger of each clip.
+Score EvaluateConfig(const std::vector<Clip>& clips, const DetectorConfig& cfg, double toleranceMs) {
+    Score score;
+    DetectorState state;
+
+    for (const auto& clip : clips) {
+        state.firstCondition = false;
+        state.whitePixels.clear();
+        state.redPixels.clear();
+
+        double resumeAtMs = -std::numeric_limits<double>::infinity();
+        double triggerMs = -1.0;
+
+        for (const auto& frame : clip.frames) {
+            if (frame.timestampMs < resumeAtMs) continue;
+
+            // Recorded frames only have their capture time
+            DetectorResult result = ProcessFrame(frame.pixels.data(), frame.size, cfg, clip.ringPixels, state,
+                                                 [&frame]() { return frame.timestampMs; },
+                                                 [&frame]() { return frame.safetyRectsBlack; });
+            if (result == DetectorResult::TimedOut) {
+                resumeAtMs = frame.timestampMs + cfg.resetDelayMs;
+            } else if (result == DetectorResult::Triggered) {
+                triggerMs = frame.timestampMs;
+                break;
+            }
+        }
+
+        if (clip.expectedTriggerMs < 0) {
+            if (triggerMs < 0) score.correct++;
+        } else if (triggerMs >= 0) {
+            double error = std::fabs(triggerMs - clip.expectedTriggerMs);
+            if (error <= toleranceMs) score.correct++;
+            score.timingErrorSum += error;
+            score.timedClips++;
+        }
+    }
+
+    return score;
+}
+
+bool IsBetter(const Score& a, const Score& b) {
+    if (a.correct != b.correct) return a.correct > b.correct;
+    return a.MeanTimingError() < b.MeanTimingError();
+}
+
+// Tie-breaker: how many grid steps a candidate moved away from the base config
+double StepsFromBase(const DetectorConfig& cfg, const DetectorConfig& base, const std::vector<ParamRange>& ranges) {
+    double steps = 0.0;
+    for (const auto& range : ranges) {
+        steps += std::abs(cfg.*(range.field) - base.*(range.field)) / (double)range.step;
+    }
+    return steps;
+}
+
+bool SameTunedValues(const DetectorConfig& a, const DetectorConfig& b, const std::vector<ParamRange>& ranges) {
+    for (const auto& range : ranges) {
+        if (a.*(range.field) != b.*(range.field)) return false;
+    }
+    return true;
+}
+
+// The base config is always candidate 0; each grid axis also gets the base
+// value so the search can land on "keep this setting as is"
+std::vector<DetectorConfig> GridCandidates(const DetectorConfig& base, const std::vector<ParamRange>& ranges) {
+    std::vector<DetectorConfig> grid;
+    grid.push_back(base);
+
+    for (const auto& range : ranges) {
+        std::vector<int> axis;
+        for (int v = range.minValue; v <= range.maxValue; v += range.step) {
+            axis.push_back(v);
+        }
+        int baseValue = base.*(range.field);
+        if (std::find(axis.begin(), axis.end(), baseValue) == axis.end()) {
+            axis.insert(std::upper_bound(axis.begin(), axis.end(), baseValue), baseValue);
+        }
+
+        std::vector<DetectorConfig> expanded;
+        for (const auto& cfg : grid) {
+            for (int v : axis) {
+                DetectorConfig next = cfg;
+                next.*(range.field) = v;
+                expanded.push_back(next);
+            }
+        }
+        grid.swap(expanded);
+    }
+
+    std::vector<DetectorConfig> candidates;
+    candidates.reserve(grid.size());
+    candidates.push_back(base);
+    for (const auto& cfg : grid) {
+        if (!SameTunedValues(cfg, base, ranges)) candidates.push_back(cfg);
+    }
+    return candidates;
+}
+
+std::vector<DetectorConfig> RandomCandidates(const DetectorConfig& base, const std::vector<ParamRange>& ranges,
+                                             int count, unsigned int seed) {
+    std::mt19937 gen(seed);
+    std::vector<DetectorConfig> candidates;
+    candidates.reserve(count + 1);
+    candidates.push_back(base);
+
+    for (int i = 0; i < count; i++) {
+        DetectorConfig cfg = base;
+        for (const auto& range : ranges) {
+            std::uniform_int_distribution<> dis(0, (range.maxValue - range.minValue) / range.step);
+            cfg.*(range.field) = range.minValue + dis(gen) * range.step;
+        }
+        candidates.push_back(cfg);
+    }
+    return candidates;
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: tuner.exe <manifest> [--config config.json] [--out tuned_config.json]\n"
+                  << "                 [--random N] [--seed S] [--threads N] [--tolerance MS]\n"
+                  << "                 [--<param> min:max:step] ...\n";
+        return 1;
+    }
+
+    std::string manifestFile = argv[1];
+    const char* configFile = "config.json";
+    const char* outFile = "tuned_config.json";
+    int randomCount = 0;
+    unsigned int seed = std::random_device{}();
+    int threadCount = (int)std::thread::hardware_concurrency();
+    double toleranceMs = 30.0;
+    std::vector<ParamRange> ranges = DefaultParamRanges();
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return 1;
+        }
+        std::string value = argv[++i];
+
+        if (arg == "--config") configFile = argv[i];
+        else if (arg == "--out") outFile = argv[i];
+        else if (arg == "--random") randomCount = std::stoi(value);
+        else if (arg == "--seed") seed = (unsigned int)std::stoul(value);
+        else if (arg == "--threads") threadCount = std::stoi(value);
+        else if (arg == "--tolerance") toleranceMs = std::stod(value);
+        else {
+            auto it = std::find_if(ranges.begin(), ranges.end(),
+                                   [&](const ParamRange& r) { return arg == std::string("--") + r.key; });
+            int minValue, maxValue, step;
+            char sep1, sep2;
+            std::istringstream in(value);
+            if (it == ranges.end() || !(in >> minValue >> sep1 >> maxValue >> sep2 >> step) ||
+                sep1 != ':' || sep2 != ':' || step <= 0 || maxValue < minValue) {
+                std::cerr << "Bad argument " << arg << " " << value << "\n";
+                return 1;
+            }
+            it->minValue = minValue;
+            it->maxValue = maxValue;
+            it->step = step;
+        }
+    }
+    if (threadCount < 1) threadCount = 1;
+
+    DetectorConfig base;
+    if (!LoadDetectorConfig(configFile, base)) {
+        std::cerr << "Config file " << configFile << " not found\n";
+        return 1;
+    }
+
+    std::vector<Clip> clips;
+    if (!LoadManifest(manifestFile, base, clips) || clips.empty()) {
+        std::cerr << "No clips loaded\n";
+        return 1;
+    }
+
+    size_t frameCount = 0;
+    for (const auto& clip : clips) frameCount += clip.frames.size();
+    std::cout << "Loaded " << clips.size() << " clips (" << frameCount << " frames)\n";
+
+    std::vector<DetectorConfig> candidates = randomCount > 0
+        ? RandomCandidates(base, ranges, randomCount, seed)
+        : GridCandidates(base, ranges);
+    std::cout << (randomCount > 0 ? "Random" : "Grid") << " search: " << candidates.size()
+              << " candidates (including the current config) on " << threadCount << " threads\n";
+
+    // Workers pull the next unclaimed candidate, so fast threads take on
+    // more work instead of idling behind a fixed partition
+    std::vector<Score> scores(candidates.size());
+    std::atomic<size_t> nextCandidate(0);
+    std::atomic<size_t> done(0);
+
+    auto startTime = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threadCount; t++) {
+        workers.emplace_back([&]() {
+            while (true) {
+                size_t i = nextCandidate.fetch_add(1);
+                if (i >= candidates.size()) break;
+                scores[i] = EvaluateConfig(clips, candidates[i], toleranceMs);
+                done++;
+            }
+        });
+    }
+
+    while (done < candidates.size()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        std::cout << "\r" << done << "/" << candidates.size();
+        std::cout.flush();
+    }
+    for (auto& worker : workers) worker.join();
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - startTime);
+    std::cout << "\rEvaluated " << candidates.size() << " candidates in " << elapsed.count() << "ms\n\n";
+
+    std::vector<size_t> order(candidates.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        if (IsBetter(scores[a], scores[b])) return true;
+        if (IsBetter(scores[b], scores[a])) return false;
+        return StepsFromBase(candidates[a], base, ranges) < StepsFromBase(candidates[b], base, ranges);
+    });
+
+    std::cout << "=== TOP CANDIDATES ===\n";
+    for (size_t rank = 0; rank < order.size() && rank < 10; rank++) {
+        const Score& score = scores[order[rank]];
+        const DetectorConfig& cfg = candidates[order[rank]];
+        std::cout << rank + 1 << ". correct=" << score.correct << "/" << clips.size()
+                  << " timing_error=" << score.MeanTimingError() << "ms |";
+        for (const auto& range : ranges) {
+            std::cout << " " << range.key << "=" << cfg.*(range.field);
+        }
+        std::cout << "\n";
+    }
+    std::cout << "======================\n\n";
+
+    // Candidate 0 is the base config; only write a new file if something beats it
+    if (!IsBetter(scores[order[0]], scores[0])) {
+        std::cout << "No candidate beats the current config (correct=" << scores[0].correct << "/"
+                  << clips.size() << " timing_error=" << scores[0].MeanTimingError()
+                  << "ms), " << outFile << " not written\n";
+        return 0;
+    }
+
+    return SaveTunedConfig(configFile, outFile, candidates[order[0]], ranges) ? 0 : 1;
+}